@@ -35,9 +35,66 @@
 #include "stdafx.h"
 
 #include "spirit2json.h"
+#include "spirit2json_instrumentation.h"
 
 namespace spirit2json {
 
+//////////////////////
+// Instrumentation //
+////////////////////
+
+namespace {
+	//! Monotonic so phase times cannot go negative when the system clock is adjusted
+	typedef boost::chrono::steady_clock steadyClock;
+
+	steadyClock::time_point now() {
+		return steadyClock::now();
+	}
+
+	unsigned long long microsecondsSince(const steadyClock::time_point& start) {
+		return boost::chrono::duration_cast<boost::chrono::microseconds>(now() - start).count();
+	}
+
+	/**
+	 * \brief Bytes written to a stream between two positions.
+	 * \param output Stream written to
+	 * \param before Position before writing
+	 * \param after Position after writing
+	 * \return Bytes written, 0 if the stream cannot tell its position
+	 */
+	unsigned long long bytesWritten(std::wostream& output, std::wostream::pos_type before, std::wostream::pos_type after) {
+		if (before == std::wostream::pos_type(-1) || after == std::wostream::pos_type(-1))
+			return 0;
+
+		const unsigned long long advanced = static_cast<unsigned long long>(after - before);
+
+		// File positions are external byte offsets after codecvt conversion,
+		// in-memory streams are positioned in characters.
+		if (dynamic_cast<std::wfilebuf*>(output.rdbuf()))
+			return advanced;
+
+		return advanced * sizeof(JSONString::value_type);
+	}
+
+	/**
+	 * \brief Report a finished generate call.
+	 * \param hook Installed Instrumentation
+	 * \param val JSONValue which was generated
+	 * \param microseconds Time spent generating
+	 * \param bytes Bytes written
+	 * \param output Generated string if one was allocated
+	 */
+	void recordGeneration(Instrumentation& hook, const JSONValue& val, unsigned long long microseconds,
+						  unsigned long long bytes, const JSONString* output) {
+		DocumentStatistics stats(analyze(val));
+		stats.bytes = bytes;
+		stats.microseconds = microseconds;
+		stats.resultAllocatedBytes = output ? estimateStringAllocation(*output) : 0;
+		stats.resultAllocations = stats.resultAllocatedBytes > 0 ? 1 : 0;
+		hook.record(PHASE_GENERATE, stats);
+	}
+}
+
 //////////////
 // PARSING //
 ////////////
@@ -114,12 +171,27 @@ struct json_grammar : qi::grammar<Iterator, JSONValue(), qi::space_type> {
 JSONValue parse(JSONString str) {
 	JSONValue result;
 
+	Instrumentation* const hook = instrumentation();
+	const steadyClock::time_point start = hook ? now() : steadyClock::time_point();
+
 	JSONString::const_iterator iter = str.begin();
 	JSONString::const_iterator end = str.end();
 
 	bool r = qi::phrase_parse(iter, end, json_grammar<JSONString::const_iterator>(), qi::space, result);
 	//TODO: Implement this right
-	if (!r || iter != str.end()) {
+	const bool failed = !r || iter != str.end();
+
+	if (hook) {
+		const unsigned long long microseconds = microsecondsSince(start);
+
+		DocumentStatistics stats(failed ? DocumentStatistics() : analyze(result));
+		stats.failed = failed;
+		stats.bytes = (iter - str.begin()) * sizeof(JSONString::value_type);
+		stats.microseconds = microseconds;
+		hook->record(PHASE_PARSE, stats);
+	}
+
+	if (failed) {
 		throw ParsingFailed();
 	}
 
@@ -131,77 +203,451 @@ JSONValue parse(JSONString str) {
 // Generation //
 ///////////////
 
+class parallelContext;
+
 /**
  * \brief Static visitor for pretty printing a JSONValue variant to an std::wostream.
+ * If given a parallelContext large containers are split and printed by several threads.
  */
 class prettyPrinter : public boost::static_visitor<> {
 	const unsigned int level;
 	std::wostream& out;
+	parallelContext* const parallel; //!< 0 for sequential printing
 
 public:
-	prettyPrinter(std::wostream& out, unsigned int level = 0) : level(level), out(out) {}
+	prettyPrinter(std::wostream& out, unsigned int level = 0, parallelContext* parallel = 0)
+		: level(level), out(out), parallel(parallel) {}
 
 	JSONString indent(unsigned int l) const {
 		return JSONString(l * 4, ' ');
 	}
 
-	void operator()(JSONNull&) const {
+	void operator()(const JSONNull&) const {
 		out << L"null";
 	}
 
-	void operator()(JSONArray &arr) const {
+	void operator()(const JSONArray &arr) const {
 		out << L"[" << std::endl;
-		for (JSONArray::iterator  it = arr.begin(); it != arr.end(); ++it) {
-			if (it != arr.begin())
-				out << L"," << std::endl;
-
-			out << indent(level + 1);
-			boost::apply_visitor ( prettyPrinter(out, level + 1), *it);
-		}
+		printMembers(arr);
 		out << std::endl << indent(level) << L"]";
 
 	}
 
-	void operator()(JSONObject &obj) const {
+	void operator()(const JSONObject &obj) const {
 		out << L"{" << std::endl;
-		for (JSONObject::iterator it = obj.begin(); it != obj.end(); ++it) {
-			if (it != obj.begin())
-				out << L',' << std::endl;
-
-			out << indent(level + 1) << L"\"" << it->first << L"\" : ";
-			boost::apply_visitor( prettyPrinter(out, level + 1), it->second);
-		}
+		printMembers(obj);
 		out << std::endl << indent(level) << L"}";
 
 	}
 
-	void operator() (JSONBool &b) const {
+	void operator() (const JSONBool &b) const {
 		out << (b ? L"true" : L"false");
 	}
 
-	void operator() (JSONString &str) const {
+	void operator() (const JSONString &str) const {
 		//TODO: This is obviously insufficient ;-) Add escape magic here.
 		out << L"\"" << str << L"\"";
 	}
 
-	void operator() (JSONNumber &num) const {
+	void operator() (const JSONNumber &num) const {
 		// Round to 16 digits. This means we can loose some precision
 		// when writing the number but we won't hit on nasty rounding
 		// problems with "normal" numbers either.
 		out.precision(std::numeric_limits<JSONNumber>::digits10 + 1);
 		out << num;
 	}
+
+	/**
+	 * \brief Print a range of container members.
+	 * \param begin First member
+	 * \param end Past the last member
+	 * \param first True if begin is the first member of its container
+	 */
+	template <typename Iterator>
+	void printRange(Iterator begin, Iterator end, bool first) const {
+		for (Iterator it = begin; it != end; ++it) {
+			if (!first || it != begin)
+				out << L"," << std::endl;
+
+			printMember(*it);
+		}
+	}
+
+private:
+	void printMember(const JSONValue& val) const {
+		out << indent(level + 1);
+		boost::apply_visitor(prettyPrinter(out, level + 1, parallel), val);
+	}
+
+	void printMember(const JSONObjectPair& pair) const {
+		out << indent(level + 1) << L"\"" << pair.first << L"\" : ";
+		boost::apply_visitor(prettyPrinter(out, level + 1, parallel), pair.second);
+	}
+
+	template <typename Container>
+	void printMembers(const Container& container) const;
+};
+
+/**
+ * \brief Output of one member range of a split container.
+ */
+struct printedRange {
+	printedRange() : done(false), precisionChanged(false), precision(0) {}
+
+	JSONString text;
+	bool done;
+	bool precisionChanged;     //!< Printing the range changed the stream precision
+	std::streamsize precision; //!< Precision the range left its buffer with
+};
+
+/**
+ * \brief Prints one member range of a split container into a buffer.
+ */
+class rangeJob {
+public:
+	virtual ~rangeJob() {}
+
+	//! Number of ranges
+	virtual std::size_t ranges() const = 0;
+
+	/**
+	 * \brief Print a range.
+	 * \param range Index of the range
+	 * \param result Receives text and precision of the range
+	 */
+	virtual void print(std::size_t range, printedRange& result) const = 0;
+};
+
+template <typename Iterator>
+class containerRangeJob : public rangeJob {
+	const std::vector<Iterator>& bounds; //!< Range i is [bounds[i], bounds[i + 1])
+	const std::wostream& format;         //!< Private prototype, never the target stream
+	const unsigned int level;
+
+public:
+	containerRangeJob(const std::vector<Iterator>& bounds, const std::wostream& format, unsigned int level)
+		: bounds(bounds), format(format), level(level) {}
+
+	virtual std::size_t ranges() const {
+		return bounds.size() - 1;
+	}
+
+	virtual void print(std::size_t range, printedRange& result) const {
+		std::wstringstream ss;
+		ss.copyfmt(format);
+
+		const std::streamsize initialPrecision = ss.precision();
+		prettyPrinter(ss, level).printRange(bounds[range], bounds[range + 1], range == 0);
+
+		result.precisionChanged = ss.precision() != initialPrecision;
+		result.precision = ss.precision();
+		result.text = ss.str();
+	}
+};
+
+/**
+ * \brief Worker threads shared by all containers split during one generate call.
+ * The calling thread prints ranges too and writes finished ranges to the
+ * target stream in order, freeing each buffer as soon as it is written.
+ * Workers only run a limited number of ranges ahead of the writer which
+ * bounds the memory held in buffers.
+ */
+class printerPool : boost::noncopyable {
+	boost::thread_group workers;
+
+	boost::mutex mutex;
+	boost::condition_variable workAvailable; //!< Signalled to workers
+	boost::condition_variable rangeDone;     //!< Signalled to the writer
+
+	bool shutdown;
+	const std::size_t window; //!< Ranges which may be printed ahead of the writer
+
+	// State of the job currently printed. Guarded by mutex.
+	const rangeJob* job;
+	std::size_t next;    //!< Next range to hand out
+	std::size_t written; //!< Ranges already written by the caller
+	std::size_t running; //!< Ranges currently printed by workers
+	std::vector<printedRange> results;
+	boost::exception_ptr error;
+
+	bool claimable() const {
+		return job && !error && next < results.size() && next < written + window;
+	}
+
+	//! Store a printed range. Requires mutex.
+	void finish(std::size_t range, printedRange& result) {
+		printedRange& stored = results[range];
+		stored.text.swap(result.text);
+		stored.precisionChanged = result.precisionChanged;
+		stored.precision = result.precision;
+		stored.done = true;
+	}
+
+	void work() {
+		boost::mutex::scoped_lock lock(mutex);
+		for (;;) {
+			while (!shutdown && !claimable())
+				workAvailable.wait(lock);
+
+			if (shutdown)
+				return;
+
+			const std::size_t range = next++;
+			++running;
+
+			lock.unlock();
+			printedRange result;
+			boost::exception_ptr failure;
+			try {
+				job->print(range, result);
+			} catch (...) {
+				failure = boost::current_exception();
+			}
+			lock.lock();
+
+			if (failure) {
+				if (!error)
+					error = failure;
+			} else {
+				finish(range, result);
+			}
+			--running;
+			rangeDone.notify_all();
+		}
+	}
+
+public:
+	explicit printerPool(unsigned int threads)
+		: shutdown(false), window(2 * std::size_t(threads)), job(0), next(0), written(0), running(0) {
+		try {
+			for (unsigned int i = 1; i < threads; ++i) {
+				workers.add_thread(new boost::thread(&printerPool::work, this));
+			}
+		} catch (...) {
+			// Out of threads or memory. Carry on with the workers we got,
+			// the calling thread prints whatever they do not.
+		}
+	}
+
+	~printerPool() {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			shutdown = true;
+		}
+		workAvailable.notify_all();
+		workers.join_all();
+	}
+
+	/**
+	 * \brief Print all ranges of a job to a stream in order.
+	 * \param out Stream to write to
+	 * \param printJob Ranges to print
+	 */
+	void print(std::wostream& out, const rangeJob& printJob) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			job = &printJob;
+			next = 0;
+			written = 0;
+			results.assign(printJob.ranges(), printedRange());
+			error = boost::exception_ptr();
+		}
+		workAvailable.notify_all();
+
+		try {
+			boost::mutex::scoped_lock lock(mutex);
+			while (written < results.size() && !error) {
+				if (results[written].done) {
+					printedRange result;
+					result.text.swap(results[written].text);
+					result.precisionChanged = results[written].precisionChanged;
+					result.precision = results[written].precision;
+					++written;
+					workAvailable.notify_all();
+
+					lock.unlock();
+					// Apply precision changes in output order to leave the
+					// stream in the same state as sequential printing would
+					if (result.precisionChanged)
+						out.precision(result.precision);
+					out << result.text;
+					lock.lock();
+				} else if (claimable()) {
+					const std::size_t range = next++;
+
+					lock.unlock();
+					printedRange result;
+					job->print(range, result);
+					lock.lock();
+
+					finish(range, result);
+				} else {
+					rangeDone.wait(lock);
+				}
+			}
+		} catch (...) {
+			boost::mutex::scoped_lock lock(mutex);
+			if (!error)
+				error = boost::current_exception();
+		}
+
+		// Workers must be done with the job before it goes out of scope
+		boost::mutex::scoped_lock lock(mutex);
+		while (running > 0)
+			rangeDone.wait(lock);
+
+		job = 0;
+		results.clear();
+
+		if (error) {
+			boost::exception_ptr failure(error);
+			error = boost::exception_ptr();
+			boost::rethrow_exception(failure);
+		}
+	}
 };
 
-JSONString generate(JSONValue& val) {
+/**
+ * \brief State shared by all prettyPrinters of one parallel generate call.
+ */
+class parallelContext : boost::noncopyable {
+	const GeneratorOptions& options;
+	const unsigned int threads; //!< options.threads clamped to what the hardware can use
+	boost::scoped_ptr<printerPool> workers; //!< Created on first split
+
+	static unsigned int usableThreads(unsigned int requested) {
+		const unsigned int maxThreadsPerCore = 4;
+		const unsigned int hardware = std::max(1u, boost::thread::hardware_concurrency());
+		return std::max(1u, std::min(requested, hardware * maxThreadsPerCore));
+	}
+
+public:
+	explicit parallelContext(const GeneratorOptions& options)
+		: options(options), threads(usableThreads(options.threads)) {}
+
+	//! Whether a container with the given number of members is split
+	bool split(std::size_t members) const {
+		// Empty containers have nothing to split, even with a threshold of 0
+		return threads > 1 && members > 0 && members >= options.parallelThreshold;
+	}
+
+	//! Number of ranges to split a container with the given number of members into
+	std::size_t ranges(std::size_t members) const {
+		// A few ranges per thread even out members of different size while
+		// an upper bound on members per range bounds the buffered output.
+		const std::size_t maxMembersPerRange = 1024;
+		return std::min(members, std::max<std::size_t>(std::size_t(threads) * 4,
+				(members + maxMembersPerRange - 1) / maxMembersPerRange));
+	}
+
+	printerPool& pool() {
+		if (!workers)
+			workers.reset(new printerPool(threads));
+		return *workers;
+	}
+};
+
+template <typename Container>
+void prettyPrinter::printMembers(const Container& container) const {
+	if (!parallel || !parallel->split(container.size())) {
+		printRange(container.begin(), container.end(), true);
+		return;
+	}
+
+	typedef typename Container::const_iterator Iterator;
+
+	const std::size_t ranges = parallel->ranges(container.size());
+	const std::size_t step = container.size() / ranges;
+	const std::size_t remainder = container.size() % ranges;
+
+	std::vector<Iterator> bounds;
+	bounds.reserve(ranges + 1);
+
+	Iterator it = container.begin();
+	for (std::size_t i = 0; i < ranges; ++i) {
+		bounds.push_back(it);
+		std::advance(it, step + (i < remainder ? 1 : 0));
+	}
+	bounds.push_back(container.end());
+
+	// Workers must not touch the target stream while it is written to. Give
+	// them a prototype with its locale, flags, precision and fill. It carries
+	// neither a pending width, which only applies to the first insertion,
+	// nor the tie, nor any callbacks registered on the target stream.
+	std::wstringstream format;
+	format.imbue(out.getloc());
+	format.flags(out.flags());
+	format.precision(out.precision());
+	format.fill(out.fill());
+
+	parallel->pool().print(out, containerRangeJob<Iterator>(bounds, format, level));
+}
+
+GeneratorOptions::GeneratorOptions()
+	: threads(std::max(1u, boost::thread::hardware_concurrency()))
+	, parallelThreshold(4096) {}
+
+JSONString generate(const JSONValue& val) {
+	Instrumentation* const hook = instrumentation();
+	const steadyClock::time_point start = hook ? now() : steadyClock::time_point();
+
 	std::wstringstream ss;
 	boost::apply_visitor(prettyPrinter(ss), val);
-	return ss.str();
+	JSONString result(ss.str());
+
+	if (hook) {
+		recordGeneration(*hook, val, microsecondsSince(start),
+						 result.size() * sizeof(JSONString::value_type), &result);
+	}
+	return result;
+}
+
+JSONString generate(const JSONValue& val, const GeneratorOptions& options) {
+	Instrumentation* const hook = instrumentation();
+	const steadyClock::time_point start = hook ? now() : steadyClock::time_point();
+
+	parallelContext context(options);
+
+	std::wstringstream ss;
+	boost::apply_visitor(prettyPrinter(ss, 0, &context), val);
+	JSONString result(ss.str());
+
+	if (hook) {
+		recordGeneration(*hook, val, microsecondsSince(start),
+						 result.size() * sizeof(JSONString::value_type), &result);
+	}
+	return result;
+}
+
+namespace {
+	/**
+	 * \brief Print to a stream and report to the installed Instrumentation, if any.
+	 * \param output Output stream to write to
+	 * \param val JSONValue to generate json from
+	 * \param parallel Parallelization context, 0 for sequential printing
+	 */
+	void print(std::wostream& output, const JSONValue& val, parallelContext* parallel) {
+		Instrumentation* const hook = instrumentation();
+		const steadyClock::time_point start = hook ? now() : steadyClock::time_point();
+		const std::wostream::pos_type before = hook ? output.tellp() : std::wostream::pos_type(-1);
+
+		boost::apply_visitor(prettyPrinter(output, 0, parallel), val);
+
+		if (hook) {
+			recordGeneration(*hook, val, microsecondsSince(start), bytesWritten(output, before, output.tellp()), 0);
+		}
+	}
+}
+
+std::wostream& generate(std::wostream& output, const JSONValue& val, const GeneratorOptions& options) {
+	parallelContext context(options);
+	print(output, val, &context);
+	return output;
 }
 
 } // namespace spirit2json
 
-std::wostream& operator<<(std::wostream& output, spirit2json::JSONValue& val) {
-	boost::apply_visitor(spirit2json::prettyPrinter(output), val);
+std::wostream& operator<<(std::wostream& output, const spirit2json::JSONValue& val) {
+	spirit2json::print(output, val, 0);
 	return output;
 }
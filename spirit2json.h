@@ -39,6 +39,11 @@
  *
  * \section Usage
  * Use spirit2::parse() to parse json and spirit2::generate() to generate it.
+ *
+ * \section Instrumentation
+ * Install a spirit2json::Instrumentation hook with spirit2json::setInstrumentation() to
+ * receive statistics for every parse and generate call. spirit2json::StatisticsCollector
+ * aggregates them in per-thread counters. Without a hook no statistics are gathered.
  */
 #ifndef SPIRIT2JSON_H
 #define SPIRIT2JSON_H
@@ -203,7 +208,54 @@ JSONValue parse(JSONString str);
  * \param val JSONValue representation
  * \return String representation
  */
-JSONString generate(JSONValue& val);
+JSONString generate(const JSONValue& val);
+
+/**
+ * \brief Options for the parallel generator.
+ * Arrays and objects with at least parallelThreshold members are split into
+ * consecutive member ranges which are generated concurrently and written in
+ * order. Smaller containers, and everything nested inside a range which is
+ * already being generated concurrently, are generated sequentially. The
+ * output is identical to the sequential generator.
+ *
+ * Worker threads are started on the first split and reused for all other
+ * containers of the same call. Only a few ranges per thread are buffered
+ * ahead of the output at any time.
+ *
+ * \note The threshold counts direct members, not their size. Containers
+ * with few but large members are not split.
+ *
+ * Usage:
+ * \code
+ * GeneratorOptions options;
+ * options.threads = 4;
+ * wstring json = generate(val, options);
+ * \endcode
+ */
+struct GeneratorOptions {
+	//! Use all hardware threads and the default threshold
+	GeneratorOptions();
+
+	unsigned int threads;          //!< Number of threads including the calling one. 1 disables parallel generation. Capped at four per hardware thread.
+	std::size_t parallelThreshold; //!< Minimum number of members for a container to be split. Defaults to 4096.
+};
+
+/**
+ * \brief Generate a JSON string representation from a given JSONValue using multiple threads.
+ * \param val JSONValue representation
+ * \param options Parallelization options
+ * \return String representation identical to generate(const JSONValue&)
+ */
+JSONString generate(const JSONValue& val, const GeneratorOptions& options);
+
+/**
+ * \brief Generate a JSON string representation to a stream using multiple threads.
+ * \param output Output stream to write to
+ * \param val JSONValue representation
+ * \param options Parallelization options
+ * \return Given output stream
+ */
+std::wostream& generate(std::wostream& output, const JSONValue& val, const GeneratorOptions& options);
 
 }
 
@@ -213,6 +265,6 @@ JSONString generate(JSONValue& val);
  * \param val JSONValue to generate json from
  * \return Given output stream
  */
-std::wostream& operator<<(std::wostream& output, spirit2json::JSONValue& val);
+std::wostream& operator<<(std::wostream& output, const spirit2json::JSONValue& val);
 
 #endif
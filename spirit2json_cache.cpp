@@ -0,0 +1,188 @@
+/**
+ * \file spirit2json_cache.cpp
+ * \author Stefan Hacker
+ * \copyright \verbatim
+ *
+ * Copyright (c) 2011, Stefan Hacker <dd0t@users.sourceforge.net>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the authors nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \endverbatim
+ */
+
+#include "stdafx.h"
+
+#include "spirit2json_cache.h"
+#include "spirit2json_instrumentation.h"
+
+namespace spirit2json {
+
+ParseCache::ParseCache(std::size_t maxBytes) : m_maxBytes(maxBytes) {
+	m_stats.hits = 0;
+	m_stats.misses = 0;
+	m_stats.evictions = 0;
+	m_stats.entries = 0;
+	m_stats.bytes = 0;
+}
+
+/**
+ * Looks up a document and updates hit and miss counters. Candidates are
+ * collected under the lock but compared with the input after releasing it,
+ * so concurrent hits on large documents do not serialize on the comparison.
+ */
+JSONValueConstPtr ParseCache::lookup(std::size_t hash, const JSONString& str) {
+	typedef std::vector<std::pair<JSONStringConstPtr, JSONValueConstPtr> > Candidates;
+	Candidates candidates;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		std::pair<EntryIndex::iterator, EntryIndex::iterator> range = m_index.equal_range(hash);
+		for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+			candidates.push_back(std::make_pair(it->second->key, it->second->value));
+		}
+	}
+
+	for (Candidates::const_iterator candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+		if (*candidate->first != str)
+			continue;
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_stats.hits;
+
+		// Mark as most recently used unless it was evicted in the meantime
+		std::pair<EntryIndex::iterator, EntryIndex::iterator> range = m_index.equal_range(hash);
+		for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+			if (it->second->key == candidate->first) {
+				m_lru.splice(m_lru.begin(), m_lru, it->second);
+				break;
+			}
+		}
+		return candidate->second;
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	++m_stats.misses;
+	return JSONValueConstPtr();
+}
+
+/**
+ * Requires m_mutex. Only used when inserting after a miss, where the
+ * comparison is cheap next to the parse which preceded it.
+ */
+ParseCache::LRUList::iterator ParseCache::find(std::size_t hash, const JSONString& str) {
+	std::pair<EntryIndex::iterator, EntryIndex::iterator> range = m_index.equal_range(hash);
+	for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+		if (*it->second->key == str)
+			return it->second;
+	}
+	return m_lru.end();
+}
+
+JSONValueConstPtr ParseCache::parse(const JSONString& str) {
+	// Hash before locking so concurrent lookups do not serialize on it
+	const std::size_t hash = boost::hash<JSONString>()(str);
+
+	JSONValueConstPtr cached(lookup(hash, str));
+	if (cached)
+		return cached;
+
+	// Parse without holding the lock so a large document does not stall
+	// concurrent hits. Should another thread insert the same document in
+	// the meantime its tree wins and ours is discarded.
+	JSONValueConstPtr value(new JSONValue(spirit2json::parse(str)));
+
+	const std::size_t cost = sizeof(JSONValue) + analyze(*value).resultAllocatedBytes
+			+ sizeof(JSONString) + estimateStringAllocation(str) + 4 * sizeof(void*) // Shared key and its control block
+			+ sizeof(Entry) + 2 * sizeof(void*) // List node links
+			+ sizeof(EntryIndex::value_type) + 2 * sizeof(void*); // Index node and bucket
+
+	if (cost > m_maxBytes)
+		return value;
+
+	Entry entry;
+	entry.hash = hash;
+	entry.key.reset(new JSONString(str));
+	entry.value = value;
+	entry.cost = cost;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	LRUList::iterator it = find(hash, str);
+	if (it != m_lru.end()) {
+		m_lru.splice(m_lru.begin(), m_lru, it);
+		return it->value;
+	}
+
+	evict(cost);
+
+	m_lru.push_front(entry);
+	try {
+		m_index.insert(EntryIndex::value_type(hash, m_lru.begin()));
+	} catch (...) {
+		m_lru.pop_front();
+		m_stats.entries = m_lru.size();
+		throw;
+	}
+
+	m_stats.bytes += cost;
+	m_stats.entries = m_lru.size();
+
+	return value;
+}
+
+void ParseCache::evict(std::size_t required) {
+	while (!m_lru.empty() && m_stats.bytes + required > m_maxBytes) {
+		LRUList::iterator victim = --m_lru.end();
+
+		std::pair<EntryIndex::iterator, EntryIndex::iterator> range = m_index.equal_range(victim->hash);
+		for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+			if (it->second == victim) {
+				m_index.erase(it);
+				break;
+			}
+		}
+
+		m_stats.bytes -= victim->cost;
+		++m_stats.evictions;
+		m_lru.erase(victim);
+	}
+	m_stats.entries = m_lru.size();
+}
+
+void ParseCache::clear() {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	m_index.clear();
+	m_lru.clear();
+	m_stats.entries = 0;
+	m_stats.bytes = 0;
+}
+
+ParseCache::Statistics ParseCache::statistics() const {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_stats;
+}
+
+} // namespace spirit2json
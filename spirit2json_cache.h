@@ -0,0 +1,145 @@
+/**
+ * \file spirit2json_cache.h
+ * \author Stefan Hacker
+ * \copyright \verbatim
+ *
+ * Copyright (c) 2011, Stefan Hacker <dd0t@users.sourceforge.net>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the authors nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \endverbatim
+ */
+#ifndef SPIRIT2JSON_CACHE_H
+#define SPIRIT2JSON_CACHE_H
+
+#include <list>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "spirit2json.h"
+
+namespace spirit2json {
+
+//! Shared handle to an immutable JSONValue
+typedef boost::shared_ptr<const JSONValue> JSONValueConstPtr;
+
+/**
+ * \brief Memory bounded cache of parsed JSON documents.
+ * Documents are addressed by their content. Repeated lookups of the same
+ * JSON string return a shared handle to the same immutable JSONValue so a
+ * hit neither parses nor copies the tree. When the estimated memory used by
+ * all cached trees exceeds the configured limit the least recently used
+ * documents are evicted. All members are safe to call concurrently.
+ *
+ * Usage:
+ * \code
+ * ParseCache cache(64 * 1024 * 1024);
+ * JSONValueConstPtr config(cache.parse(loadConfig()));
+ * wcout << generate(*config) << endl;
+ * ...
+ * ParseCache::Statistics stats(cache.statistics());
+ * \endcode
+ */
+class ParseCache : boost::noncopyable {
+public:
+	/**
+	 * \brief Snapshot of cache counters.
+	 */
+	struct Statistics {
+		unsigned long long hits;      //!< Lookups answered from the cache
+		unsigned long long misses;    //!< Lookups which had to parse
+		unsigned long long evictions; //!< Documents dropped to honor the memory limit
+		std::size_t entries;          //!< Documents currently cached
+		std::size_t bytes;            //!< Estimated memory used by cached documents
+	};
+
+	/**
+	 * \brief Create an empty cache.
+	 * \param maxBytes Upper bound for the estimated memory used by cached documents
+	 */
+	explicit ParseCache(std::size_t maxBytes);
+
+	/**
+	 * \brief Return the JSONValue representation of a given JSON string.
+	 * Parses and caches the document if it has not been seen before.
+	 * Documents larger than the whole cache are parsed but not cached.
+	 * \param str JSON string
+	 * \throw ParsingFailed Parser failure. Failures are not cached.
+	 * \return Shared immutable JSONValue representation
+	 */
+	JSONValueConstPtr parse(const JSONString& str);
+
+	/**
+	 * \brief Drop all cached documents. Counters are kept.
+	 * Handles returned earlier stay valid.
+	 */
+	void clear();
+
+	/**
+	 * \return Current counter values
+	 */
+	Statistics statistics() const;
+
+	/**
+	 * \return Memory limit given on construction
+	 */
+	std::size_t maxBytes() const { return m_maxBytes; }
+
+private:
+	typedef boost::shared_ptr<const JSONString> JSONStringConstPtr;
+
+	struct Entry {
+		std::size_t hash;
+		JSONStringConstPtr key; //!< Shared so hits can compare it without holding the lock
+		JSONValueConstPtr value;
+		std::size_t cost;
+	};
+
+	//! Cached documents, most recently used first
+	typedef std::list<Entry> LRUList;
+	//! Entries of m_lru by hash of their key. Collisions are resolved by comparing keys.
+	typedef boost::unordered_multimap<std::size_t, LRUList::iterator> EntryIndex;
+
+	JSONValueConstPtr lookup(std::size_t hash, const JSONString& str);
+	LRUList::iterator find(std::size_t hash, const JSONString& str);
+	void evict(std::size_t required);
+
+	const std::size_t m_maxBytes;
+
+	mutable boost::mutex m_mutex;
+	LRUList m_lru;
+	EntryIndex m_index;
+	Statistics m_stats;
+};
+
+}
+
+#endif
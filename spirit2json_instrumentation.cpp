@@ -0,0 +1,300 @@
+/**
+ * \file spirit2json_instrumentation.cpp
+ * \author Stefan Hacker
+ * \copyright \verbatim
+ *
+ * Copyright (c) 2011, Stefan Hacker <dd0t@users.sourceforge.net>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the authors nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \endverbatim
+ */
+
+#include "stdafx.h"
+
+#include "spirit2json_instrumentation.h"
+
+#include <boost/atomic.hpp>
+
+namespace spirit2json {
+
+namespace {
+	boost::atomic<Instrumentation*> installedHook(0);
+}
+
+void setInstrumentation(Instrumentation* hook) {
+	installedHook.store(hook, boost::memory_order_release);
+}
+
+Instrumentation* instrumentation() {
+	return installedHook.load(boost::memory_order_acquire);
+}
+
+DocumentStatistics::DocumentStatistics()
+	: failed(false)
+	, bytes(0)
+	, maxDepth(0)
+	, stringBytes(0)
+	, resultAllocations(0)
+	, resultAllocatedBytes(0)
+	, microseconds(0) {
+	std::fill(nodes, nodes + JSON_TYPE_COUNT, 0);
+}
+
+/**
+ * \brief Static visitor gathering DocumentStatistics for a JSONValue.
+ */
+class statisticsVisitor : public boost::static_visitor<> {
+	const unsigned int level;
+	DocumentStatistics& stats;
+
+	//! Rough per node bookkeeping overhead of std::map (color and three links)
+	static const std::size_t mapNodeOverhead = 4 * sizeof(void*);
+
+	void visited(JSONValueTypes type) const {
+		++stats.nodes[type];
+		stats.maxDepth = std::max(stats.maxDepth, level);
+	}
+
+	void countString(const JSONString& str) const {
+		stats.stringBytes += str.size() * sizeof(JSONString::value_type);
+
+		const std::size_t allocated = estimateStringAllocation(str);
+		if (allocated > 0) {
+			++stats.resultAllocations;
+			stats.resultAllocatedBytes += allocated;
+		}
+	}
+
+public:
+	statisticsVisitor(DocumentStatistics& stats, unsigned int level = 1) : level(level), stats(stats) {}
+
+	void operator()(const JSONNull&) const {
+		visited(JSON_NULL);
+	}
+
+	void operator()(const JSONArray& arr) const {
+		visited(JSON_ARRAY);
+		if (arr.capacity() > 0) {
+			++stats.resultAllocations;
+			stats.resultAllocatedBytes += arr.capacity() * sizeof(JSONValue);
+		}
+
+		for (JSONArray::const_iterator it = arr.begin(); it != arr.end(); ++it) {
+			boost::apply_visitor(statisticsVisitor(stats, level + 1), *it);
+		}
+	}
+
+	void operator()(const JSONObject& obj) const {
+		visited(JSON_OBJECT);
+		stats.resultAllocations += obj.size();
+		stats.resultAllocatedBytes += obj.size() * (sizeof(JSONObjectPair) + mapNodeOverhead);
+
+		for (JSONObject::const_iterator it = obj.begin(); it != obj.end(); ++it) {
+			countString(it->first);
+			boost::apply_visitor(statisticsVisitor(stats, level + 1), it->second);
+		}
+	}
+
+	void operator()(const JSONBool&) const {
+		visited(JSON_BOOL);
+	}
+
+	void operator()(const JSONString& str) const {
+		visited(JSON_STRING);
+		countString(str);
+	}
+
+	void operator()(const JSONNumber&) const {
+		visited(JSON_NUMBER);
+	}
+};
+
+std::size_t estimateStringAllocation(const JSONString& str) {
+	// Strings fitting the small string buffer do not allocate
+	if (str.capacity() <= JSONString().capacity())
+		return 0;
+
+	return (str.capacity() + 1) * sizeof(JSONString::value_type);
+}
+
+DocumentStatistics analyze(const JSONValue& val) {
+	DocumentStatistics stats;
+	boost::apply_visitor(statisticsVisitor(stats), val);
+	return stats;
+}
+
+PhaseStatistics::PhaseStatistics()
+	: calls(0)
+	, failures(0)
+	, bytes(0)
+	, maxBytes(0)
+	, maxDepth(0)
+	, stringBytes(0)
+	, resultAllocations(0)
+	, resultAllocatedBytes(0)
+	, microseconds(0) {
+	std::fill(nodes, nodes + JSON_TYPE_COUNT, 0);
+}
+
+void PhaseStatistics::add(const DocumentStatistics& stats) {
+	++calls;
+	if (stats.failed)
+		++failures;
+
+	bytes += stats.bytes;
+	maxBytes = std::max(maxBytes, stats.bytes);
+	for (unsigned int i = 0; i < JSON_TYPE_COUNT; ++i) {
+		nodes[i] += stats.nodes[i];
+	}
+	maxDepth = std::max(maxDepth, stats.maxDepth);
+	stringBytes += stats.stringBytes;
+	resultAllocations += stats.resultAllocations;
+	resultAllocatedBytes += stats.resultAllocatedBytes;
+	microseconds += stats.microseconds;
+}
+
+PhaseStatistics& PhaseStatistics::operator+=(const PhaseStatistics& other) {
+	calls += other.calls;
+	failures += other.failures;
+	bytes += other.bytes;
+	maxBytes = std::max(maxBytes, other.maxBytes);
+	for (unsigned int i = 0; i < JSON_TYPE_COUNT; ++i) {
+		nodes[i] += other.nodes[i];
+	}
+	maxDepth = std::max(maxDepth, other.maxDepth);
+	stringBytes += other.stringBytes;
+	resultAllocations += other.resultAllocations;
+	resultAllocatedBytes += other.resultAllocatedBytes;
+	microseconds += other.microseconds;
+	return *this;
+}
+
+namespace {
+	boost::atomic<unsigned long long> nextCollectorId(0);
+}
+
+boost::thread_specific_ptr<StatisticsCollector::LocalCounters> StatisticsCollector::s_local;
+
+StatisticsCollector::StatisticsCollector() : m_id(nextCollectorId++) {}
+
+StatisticsCollector::Counters& StatisticsCollector::localCounters() {
+	LocalCounters* local = s_local.get();
+	if (!local) {
+		local = new LocalCounters();
+		s_local.reset(local);
+	}
+
+	LocalCounters::iterator it = local->find(m_id);
+	if (it != local->end()) {
+		// Kept alive by m_counters for as long as this collector exists
+		return *it->second.lock();
+	}
+
+	// Forget counters of collectors which no longer exist
+	for (it = local->begin(); it != local->end(); ) {
+		if (it->second.expired())
+			local->erase(it++);
+		else
+			++it;
+	}
+
+	boost::shared_ptr<Counters> created(new Counters());
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_counters.push_back(created);
+	}
+	local->insert(LocalCounters::value_type(m_id, created));
+
+	return *created;
+}
+
+void StatisticsCollector::record(InstrumentationPhase phase, const DocumentStatistics& stats) {
+	Counters& counters = localCounters();
+
+	boost::mutex::scoped_lock lock(counters.mutex);
+	counters.phases[phase].add(stats);
+}
+
+StatisticsCollector::Snapshot StatisticsCollector::snapshot() const {
+	Snapshot result;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	for (std::vector<boost::shared_ptr<Counters> >::const_iterator it = m_counters.begin(); it != m_counters.end(); ++it) {
+		boost::mutex::scoped_lock counterLock((*it)->mutex);
+		result.parse += (*it)->phases[PHASE_PARSE];
+		result.generate += (*it)->phases[PHASE_GENERATE];
+	}
+	result.threads = static_cast<unsigned int>(m_counters.size());
+
+	return result;
+}
+
+void StatisticsCollector::reset() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	for (std::vector<boost::shared_ptr<Counters> >::iterator it = m_counters.begin(); it != m_counters.end(); ++it) {
+		boost::mutex::scoped_lock counterLock((*it)->mutex);
+		(*it)->phases[PHASE_PARSE] = PhaseStatistics();
+		(*it)->phases[PHASE_GENERATE] = PhaseStatistics();
+	}
+}
+
+namespace {
+	/**
+	 * \brief Convert PhaseStatistics to a JSONObject
+	 */
+	JSONValue phaseToJSON(const PhaseStatistics& stats) {
+		JSONObject nodes;
+		nodes.insert(JSONObjectPair(L"string", JSONNumber(stats.nodes[JSON_STRING])));
+		nodes.insert(JSONObjectPair(L"number", JSONNumber(stats.nodes[JSON_NUMBER])));
+		nodes.insert(JSONObjectPair(L"bool", JSONNumber(stats.nodes[JSON_BOOL])));
+		nodes.insert(JSONObjectPair(L"null", JSONNumber(stats.nodes[JSON_NULL])));
+		nodes.insert(JSONObjectPair(L"array", JSONNumber(stats.nodes[JSON_ARRAY])));
+		nodes.insert(JSONObjectPair(L"object", JSONNumber(stats.nodes[JSON_OBJECT])));
+
+		JSONObject phase;
+		phase.insert(JSONObjectPair(L"calls", JSONNumber(stats.calls)));
+		phase.insert(JSONObjectPair(L"failures", JSONNumber(stats.failures)));
+		phase.insert(JSONObjectPair(L"bytes", JSONNumber(stats.bytes)));
+		phase.insert(JSONObjectPair(L"maxBytes", JSONNumber(stats.maxBytes)));
+		phase.insert(JSONObjectPair(L"nodes", nodes));
+		phase.insert(JSONObjectPair(L"maxDepth", JSONNumber(stats.maxDepth)));
+		phase.insert(JSONObjectPair(L"stringBytes", JSONNumber(stats.stringBytes)));
+		phase.insert(JSONObjectPair(L"resultAllocations", JSONNumber(stats.resultAllocations)));
+		phase.insert(JSONObjectPair(L"resultAllocatedBytes", JSONNumber(stats.resultAllocatedBytes)));
+		phase.insert(JSONObjectPair(L"microseconds", JSONNumber(stats.microseconds)));
+		return phase;
+	}
+}
+
+JSONValue StatisticsCollector::Snapshot::toJSON() const {
+	JSONObject result;
+	result.insert(JSONObjectPair(L"parse", phaseToJSON(parse)));
+	result.insert(JSONObjectPair(L"generate", phaseToJSON(generate)));
+	result.insert(JSONObjectPair(L"threads", JSONNumber(threads)));
+	return result;
+}
+
+} // namespace spirit2json
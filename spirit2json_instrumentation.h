@@ -0,0 +1,218 @@
+/**
+ * \file spirit2json_instrumentation.h
+ * \author Stefan Hacker
+ * \copyright \verbatim
+ *
+ * Copyright (c) 2011, Stefan Hacker <dd0t@users.sourceforge.net>
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the authors nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \endverbatim
+ */
+#ifndef SPIRIT2JSON_INSTRUMENTATION_H
+#define SPIRIT2JSON_INSTRUMENTATION_H
+
+#include <vector>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "spirit2json.h"
+
+namespace spirit2json {
+
+//! Number of distinct JSONValueTypes
+const unsigned int JSON_TYPE_COUNT = JSON_OBJECT + 1;
+
+/**
+ * \brief Phases reported to Instrumentation hooks.
+ */
+enum InstrumentationPhase
+{
+	PHASE_PARSE,   //!< spirit2json::parse()
+	PHASE_GENERATE //!< spirit2json::generate() and stream output
+};
+
+/**
+ * \brief Statistics gathered for a single parse or generate call.
+ *
+ * bytes counts sizeof(wchar_t) per character of a JSONString or of a stream
+ * positioned in characters. For file streams it is the number of bytes
+ * written after conversion. It is 0 for streams which cannot tell their
+ * position.
+ *
+ * resultAllocations and resultAllocatedBytes only estimate what the
+ * result holds on to: the JSONValue tree built by parse or the string
+ * returned by generate. They are 0 when generating to a stream. Temporary
+ * allocations made while parsing or printing are not included, so these
+ * are neither peak nor total allocation figures.
+ */
+struct DocumentStatistics {
+	DocumentStatistics();
+
+	bool failed;                             //!< Parser failure. Only bytes and microseconds are valid.
+	unsigned long long bytes;                //!< Input consumed respectively output produced in bytes, see below
+	unsigned long long nodes[JSON_TYPE_COUNT]; //!< Number of values indexed by JSONValueTypes
+	unsigned int maxDepth;                   //!< Deepest nesting level. A lone scalar has depth 1.
+	unsigned long long stringBytes;          //!< Unescaped bytes in strings and object keys
+	unsigned long long resultAllocations;    //!< Estimated heap allocations held by the result, see below
+	unsigned long long resultAllocatedBytes; //!< Estimated bytes in those allocations
+	unsigned long long microseconds;         //!< Wall time spent in the phase
+};
+
+/**
+ * \brief Gather structural statistics of a JSONValue AST.
+ * Fills in nodes, maxDepth, stringBytes, resultAllocations and resultAllocatedBytes,
+ * the latter two describing the heap memory held by the tree.
+ * \param val JSONValue to inspect
+ * \return Statistics with all other members zeroed
+ */
+DocumentStatistics analyze(const JSONValue& val);
+
+/**
+ * \brief Estimate the heap memory a JSONString allocates for its characters.
+ * This is the rule analyze() applies to every string and object key.
+ * \param str String to inspect
+ * \return Bytes allocated, 0 if the string fits its small string buffer
+ */
+std::size_t estimateStringAllocation(const JSONString& str);
+
+/**
+ * \brief Interface for instrumentation hooks.
+ * Once installed with setInstrumentation() record() is called after every
+ * parse and generate from whatever thread performed it. Implementations
+ * must be thread-safe.
+ */
+class Instrumentation {
+public:
+	virtual ~Instrumentation() {}
+
+	/**
+	 * \brief Called after each instrumented call.
+	 * \param phase Phase which finished
+	 * \param stats Statistics for this call
+	 */
+	virtual void record(InstrumentationPhase phase, const DocumentStatistics& stats) = 0;
+};
+
+/**
+ * \brief Install an instrumentation hook.
+ * Without a hook parse() and generate() skip all timing and analysis.
+ * The hook must outlive all calls which might still report to it.
+ * \param hook Hook to install, 0 to disable instrumentation
+ */
+void setInstrumentation(Instrumentation* hook);
+
+/**
+ * \return Currently installed hook or 0 if instrumentation is disabled
+ */
+Instrumentation* instrumentation();
+
+/**
+ * \brief Aggregated statistics for one phase.
+ */
+struct PhaseStatistics {
+	PhaseStatistics();
+
+	//! Add a single call
+	void add(const DocumentStatistics& stats);
+	//! Merge with statistics of another thread
+	PhaseStatistics& operator+=(const PhaseStatistics& other);
+
+	unsigned long long calls;                  //!< Number of calls
+	unsigned long long failures;               //!< Number of failed calls
+	unsigned long long bytes;                  //!< Sum of DocumentStatistics::bytes
+	unsigned long long maxBytes;               //!< Largest DocumentStatistics::bytes
+	unsigned long long nodes[JSON_TYPE_COUNT]; //!< Sum of DocumentStatistics::nodes
+	unsigned int maxDepth;                     //!< Largest DocumentStatistics::maxDepth
+	unsigned long long stringBytes;            //!< Sum of DocumentStatistics::stringBytes
+	unsigned long long resultAllocations;      //!< Sum of DocumentStatistics::resultAllocations
+	unsigned long long resultAllocatedBytes;   //!< Sum of DocumentStatistics::resultAllocatedBytes
+	unsigned long long microseconds;           //!< Sum of DocumentStatistics::microseconds
+};
+
+/**
+ * \brief Instrumentation hook collecting statistics into per-thread counters.
+ *
+ * Usage:
+ * \code
+ * StatisticsCollector collector;
+ * setInstrumentation(&collector);
+ * ...
+ * StatisticsCollector::Snapshot snapshot(collector.snapshot());
+ * wcout << generate(snapshot.toJSON()) << endl;
+ * \endcode
+ */
+class StatisticsCollector : public Instrumentation, boost::noncopyable {
+public:
+	/**
+	 * \brief Statistics aggregated over all threads.
+	 */
+	struct Snapshot {
+		Snapshot() : threads(0) {}
+
+		//! Export as a JSONObject
+		JSONValue toJSON() const;
+
+		PhaseStatistics parse;    //!< Parse phase
+		PhaseStatistics generate; //!< Generate phase
+		unsigned int threads;     //!< Threads which reported
+	};
+
+	StatisticsCollector();
+
+	virtual void record(InstrumentationPhase phase, const DocumentStatistics& stats);
+
+	//! Aggregate the counters of all threads
+	Snapshot snapshot() const;
+
+	//! Zero the counters of all threads
+	void reset();
+
+private:
+	struct Counters {
+		boost::mutex mutex; //!< Only contended while taking a snapshot
+		PhaseStatistics phases[PHASE_GENERATE + 1];
+	};
+
+	//! Counters of the current thread by collector id. Ids are never reused.
+	typedef std::map<unsigned long long, boost::weak_ptr<Counters> > LocalCounters;
+	static boost::thread_specific_ptr<LocalCounters> s_local;
+
+	Counters& localCounters();
+
+	const unsigned long long m_id;
+
+	mutable boost::mutex m_mutex;
+	std::vector<boost::shared_ptr<Counters> > m_counters;
+};
+
+}
+
+#endif
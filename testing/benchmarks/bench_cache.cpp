@@ -0,0 +1,93 @@
+/*
+	Benchmark for ParseCache on a skewed workload.
+
+	Documents are requested following a Zipf like distribution so a small
+	set of hot documents makes up most of the lookups. Run from the
+	repository root so the sample files can be found.
+*/
+#include <spirit2json_cache.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace std;
+using namespace spirit2json;
+
+JSONString loadFile(const std::string& path) {
+	wifstream file(path.c_str());
+	wstringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+int main(int argc, char** argv) {
+	const int lookups = argc > 1 ? atoi(argv[1]) : 20000;
+
+	const char* samples[] = {
+		"testing/samples/json_org_glossary_sample.json",
+		"testing/samples/json_org_menu_sample.json",
+		"testing/samples/json_org_web_app_sample.json",
+		"testing/samples/json_org_widget_sample.json",
+		"testing/samples/small_sample.json"
+	};
+
+	// Derive 100 distinct documents by wrapping each sample with a unique id
+	vector<JSONString> documents;
+	for (int i = 0; i < 100; ++i) {
+		wstringstream ss;
+		ss << L"{\"id\":" << i << L", \"payload\":" << loadFile(samples[i % 5]) << L"}";
+		documents.push_back(ss.str());
+	}
+
+	// Zipf (s = 1) cumulative distribution over documents
+	vector<double> cdf;
+	double sum = 0;
+	for (size_t i = 0; i < documents.size(); ++i) {
+		sum += 1.0 / (i + 1);
+		cdf.push_back(sum);
+	}
+
+	srand(42);
+	vector<size_t> requests;
+	for (int i = 0; i < lookups; ++i) {
+		const double r = sum * rand() / RAND_MAX;
+		requests.push_back(lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin());
+	}
+
+	using namespace boost::posix_time;
+
+	ptime start = microsec_clock::universal_time();
+	for (size_t i = 0; i < requests.size(); ++i) {
+		JSONValue value(parse(documents[requests[i]]));
+	}
+	const double uncached = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+	wcout << L"uncached: " << uncached << L" ms" << endl;
+
+	const size_t limits[] = { 16 * 1024, 64 * 1024, 1024 * 1024 };
+	for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); ++l) {
+		ParseCache cache(limits[l]);
+
+		start = microsec_clock::universal_time();
+		for (size_t i = 0; i < requests.size(); ++i) {
+			JSONValueConstPtr value(cache.parse(documents[requests[i]]));
+		}
+		const double cached = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+
+		ParseCache::Statistics stats(cache.statistics());
+		wcout << L"cached (" << limits[l] / 1024 << L" KiB): " << cached << L" ms"
+			  << L", speedup " << uncached / cached
+			  << L", hits " << stats.hits
+			  << L", misses " << stats.misses
+			  << L", evictions " << stats.evictions
+			  << L", entries " << stats.entries
+			  << L", bytes " << stats.bytes << endl;
+	}
+
+	return 0;
+}
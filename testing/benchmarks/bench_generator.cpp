@@ -0,0 +1,70 @@
+/*
+	Benchmark for the parallel generator.
+
+	Builds a large JSONObject by replicating the members of the coordinate
+	sample and generates it with an increasing number of threads. Run from
+	the repository root so the sample file can be found.
+*/
+#include <spirit2json.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <boost/variant.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace std;
+using namespace spirit2json;
+
+JSONString loadFile(const std::string& path) {
+	wifstream file(path.c_str());
+	wstringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+int main(int argc, char** argv) {
+	const int copies = argc > 1 ? atoi(argv[1]) : 200;
+	const unsigned int maxThreads = argc > 2 ? atoi(argv[2]) : 8;
+
+	JSONValue sample(parse(loadFile("testing/samples/coordinate_sample.json")));
+	JSONObject& members = boost::get<JSONObject>(sample);
+
+	JSONObject large;
+	for (int i = 0; i < copies; ++i) {
+		wstringstream suffix;
+		suffix << L"_" << i;
+		for (JSONObject::const_iterator it = members.begin(); it != members.end(); ++it) {
+			large.insert(JSONObjectPair(it->first + suffix.str(), it->second));
+		}
+	}
+	JSONValue val(large);
+
+	using namespace boost::posix_time;
+
+	ptime start = microsec_clock::universal_time();
+	const JSONString sequential(generate(val));
+	const double baseline = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+
+	wcout << large.size() << L" members, "
+		  << sequential.size() * sizeof(JSONString::value_type) / (1024 * 1024) << L" MiB output" << endl;
+	wcout << L"sequential: " << baseline << L" ms" << endl;
+	// Speedups are only meaningful for thread counts up to this
+	wcout << boost::thread::hardware_concurrency() << L" hardware threads" << endl;
+
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+		GeneratorOptions options;
+		options.threads = threads;
+
+		start = microsec_clock::universal_time();
+		const JSONString parallel(generate(val, options));
+		const double elapsed = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+
+		wcout << threads << L" threads: " << elapsed << L" ms, speedup " << baseline / elapsed
+			  << (parallel == sequential ? L"" : L" (OUTPUT DIFFERS)") << endl;
+	}
+
+	return 0;
+}
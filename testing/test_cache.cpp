@@ -0,0 +1,144 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <spirit2json_cache.h>
+#include <string>
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace spirit2json;
+
+BOOST_AUTO_TEST_SUITE(test_cache)
+
+BOOST_AUTO_TEST_CASE(hit_returns_shared_tree) {
+	ParseCache cache(1024 * 1024);
+
+	JSONValueConstPtr first(cache.parse(L"{\"hello\":\"world\", \"array\":[4,2]}"));
+	JSONValueConstPtr second(cache.parse(L"{\"hello\":\"world\", \"array\":[4,2]}"));
+
+	BOOST_CHECK(first == second);
+	BOOST_CHECK(*first == parse(L"{\"hello\":\"world\", \"array\":[4,2]}"));
+
+	ParseCache::Statistics stats(cache.statistics());
+	BOOST_CHECK_EQUAL(stats.hits, 1u);
+	BOOST_CHECK_EQUAL(stats.misses, 1u);
+	BOOST_CHECK_EQUAL(stats.evictions, 0u);
+	BOOST_CHECK_EQUAL(stats.entries, 1u);
+	BOOST_CHECK(stats.bytes > 0);
+}
+
+BOOST_AUTO_TEST_CASE(distinct_documents) {
+	ParseCache cache(1024 * 1024);
+
+	JSONValueConstPtr a(cache.parse(L"[1,2,3]"));
+	JSONValueConstPtr b(cache.parse(L"[1, 2, 3]"));
+
+	BOOST_CHECK(a != b);
+	BOOST_CHECK(*a == *b);
+	BOOST_CHECK_EQUAL(cache.statistics().misses, 2u);
+	BOOST_CHECK_EQUAL(cache.statistics().entries, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(failures_are_not_cached) {
+	ParseCache cache(1024 * 1024);
+
+	BOOST_CHECK_THROW(cache.parse(L"[1,2"), ParsingFailed);
+	BOOST_CHECK_THROW(cache.parse(L"[1,2"), ParsingFailed);
+
+	BOOST_CHECK_EQUAL(cache.statistics().misses, 2u);
+	BOOST_CHECK_EQUAL(cache.statistics().entries, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(lru_eviction) {
+	ParseCache probe(1024 * 1024);
+	probe.parse(L"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\"]");
+	const size_t cost = probe.statistics().bytes;
+
+	// Room for two documents of identical cost
+	ParseCache cache(cost * 2 + cost / 2);
+
+	JSONValueConstPtr a(cache.parse(L"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\"]"));
+	cache.parse(L"[\"bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb\"]");
+	cache.parse(L"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\"]"); // Touch a, b is now least recently used
+	cache.parse(L"[\"cccccccccccccccccccccccccccccccc\"]");
+
+	ParseCache::Statistics stats(cache.statistics());
+	BOOST_CHECK_EQUAL(stats.evictions, 1u);
+	BOOST_CHECK_EQUAL(stats.entries, 2u);
+	BOOST_CHECK(stats.bytes <= cache.maxBytes());
+
+	BOOST_CHECK(cache.parse(L"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\"]") == a);
+	BOOST_CHECK_EQUAL(cache.statistics().hits, 2u);
+
+	cache.parse(L"[\"bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb\"]");
+	BOOST_CHECK_EQUAL(cache.statistics().misses, 4u);
+}
+
+BOOST_AUTO_TEST_CASE(oversized_documents_bypass_cache) {
+	ParseCache cache(16);
+
+	JSONValueConstPtr a(cache.parse(L"{\"key\":\"value\"}"));
+	JSONValueConstPtr b(cache.parse(L"{\"key\":\"value\"}"));
+
+	BOOST_CHECK(a != b);
+	BOOST_CHECK(*a == *b);
+	BOOST_CHECK_EQUAL(cache.statistics().entries, 0u);
+	BOOST_CHECK_EQUAL(cache.statistics().bytes, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(clear_keeps_handles) {
+	ParseCache cache(1024 * 1024);
+
+	JSONValueConstPtr a(cache.parse(L"[true, false, null]"));
+	cache.clear();
+
+	BOOST_CHECK_EQUAL(cache.statistics().entries, 0u);
+	BOOST_CHECK_EQUAL(cache.statistics().bytes, 0u);
+	BOOST_CHECK(*a == parse(L"[true, false, null]"));
+	BOOST_CHECK(cache.parse(L"[true, false, null]") != a);
+}
+
+BOOST_AUTO_TEST_CASE(generate_from_shared_tree) {
+	ParseCache cache(1024 * 1024);
+
+	JSONValueConstPtr config(cache.parse(L"{\"hello\":\"world\", \"array\":[4,2]}"));
+	JSONValue copy(*config);
+
+	BOOST_CHECK(generate(*config) == generate(copy));
+
+	wstringstream ss;
+	ss << *config;
+	BOOST_CHECK(ss.str() == generate(copy));
+
+	GeneratorOptions options;
+	options.threads = 2;
+	options.parallelThreshold = 1;
+	BOOST_CHECK(generate(*config, options) == generate(copy));
+}
+
+void hammer(ParseCache* cache, int seed) {
+	for (int i = 0; i < 200; ++i) {
+		wstringstream ss;
+		ss << L"[" << (i * seed) % 13 << L"]";
+		cache->parse(ss.str());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_access) {
+	ParseCache cache(4 * 1024);
+
+	boost::thread_group threads;
+	for (int i = 1; i <= 4; ++i) {
+		threads.create_thread(boost::bind(&hammer, &cache, i));
+	}
+	threads.join_all();
+
+	ParseCache::Statistics stats(cache.statistics());
+	BOOST_CHECK_EQUAL(stats.hits + stats.misses, 800u);
+	BOOST_CHECK(stats.bytes <= cache.maxBytes());
+	BOOST_CHECK(stats.entries <= 13u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
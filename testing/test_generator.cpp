@@ -3,6 +3,7 @@
 #include <spirit2json.h>
 #include <string>
 #include <fstream>
+#include <limits>
 #include <boost/test/unit_test.hpp>
 
 using namespace std;
@@ -68,6 +69,197 @@ BOOST_AUTO_TEST_CASE(roundtrip_tests) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(parallel_matches_sequential) {
+	const char* samples[] = {
+		"testing/samples/json_org_glossary_sample.json",
+		"testing/samples/json_org_menu_sample.json",
+		"testing/samples/json_org_web_app_sample.json",
+		"testing/samples/json_org_widget_sample.json",
+		"testing/samples/coordinate_sample.json",
+		"testing/samples/small_sample.json"
+	};
+
+	for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+		JSONValue original(parse(loadFile(samples[i])));
+		const JSONString sequential(generate(original));
+
+		for (unsigned int threads = 1; threads <= 8; threads *= 2) {
+			GeneratorOptions options;
+			options.threads = threads;
+			options.parallelThreshold = 1;
+
+			BOOST_CHECK(generate(original, options) == sequential);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(parallel_nested_containers) {
+	JSONArray inner;
+	for (int i = 0; i < 100; ++i) {
+		inner.push_back(JSONValue(i + 0.5));
+	}
+
+	JSONObject outer;
+	outer.insert(JSONObjectPair(L"empty", JSONArray()));
+	outer.insert(JSONObjectPair(L"large", inner));
+	outer.insert(JSONObjectPair(L"small", JSONArray(3, JSONValue(true))));
+
+	JSONArray root;
+	root.push_back(JSONValue(outer));
+	root.push_back(JSONValue(L"tail"));
+
+	JSONValue val(root);
+	const JSONString sequential(generate(val));
+
+	GeneratorOptions options;
+	options.threads = 3;
+
+	// Only the nested array is large enough to be split
+	options.parallelThreshold = 50;
+	BOOST_CHECK(generate(val, options) == sequential);
+
+	// Everything is split down to single members
+	options.parallelThreshold = 1;
+	BOOST_CHECK(generate(val, options) == sequential);
+
+	// Nothing is split
+	options.parallelThreshold = 1000;
+	BOOST_CHECK(generate(val, options) == sequential);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_many_splits) {
+	// Many split containers share one pool, the large array needs more
+	// ranges than are buffered ahead of the output.
+	JSONObject root;
+	for (int i = 0; i < 20; ++i) {
+		wstringstream key;
+		key << L"array" << i;
+		root.insert(JSONObjectPair(key.str(), JSONArray(50, JSONValue(i * 1.5))));
+	}
+
+	JSONArray large;
+	for (int i = 0; i < 5000; ++i) {
+		large.push_back(JSONValue(i % 2 ? JSONValue(L"odd") : JSONValue(JSONArray(2, JSONValue(JSONNumber(i))))));
+	}
+	root.insert(JSONObjectPair(L"large", large));
+
+	JSONValue val(root);
+	const JSONString sequential(generate(val));
+
+	for (unsigned int threads = 2; threads <= 8; threads *= 2) {
+		GeneratorOptions options;
+		options.threads = threads;
+		options.parallelThreshold = 10;
+
+		BOOST_CHECK(generate(val, options) == sequential);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(parallel_zero_threshold) {
+	GeneratorOptions options;
+	options.threads = 2;
+	options.parallelThreshold = 0;
+
+	JSONValue empty((JSONArray()));
+	BOOST_CHECK(generate(empty, options) == generate(empty));
+
+	JSONObject nested;
+	nested.insert(JSONObjectPair(L"array", JSONArray()));
+	nested.insert(JSONObjectPair(L"object", JSONObject()));
+	JSONValue val(nested);
+	BOOST_CHECK(generate(val, options) == generate(val));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_excessive_threads) {
+	JSONValue original(parse(loadFile("testing/samples/coordinate_sample.json")));
+
+	GeneratorOptions options;
+	options.threads = numeric_limits<unsigned int>::max();
+	options.parallelThreshold = 1;
+
+	BOOST_CHECK(generate(original, options) == generate(original));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_stream_output) {
+	JSONValue original(parse(loadFile("testing/samples/coordinate_sample.json")));
+
+	wstringstream sequential;
+	sequential << L"prefix ";
+	sequential.width(10);
+	sequential << original;
+
+	GeneratorOptions options;
+	options.threads = 4;
+	options.parallelThreshold = 16;
+
+	wstringstream parallel;
+	parallel << L"prefix ";
+	parallel.width(10);
+	generate(parallel, original, options);
+
+	BOOST_CHECK(parallel.str() == sequential.str());
+	BOOST_CHECK_EQUAL(parallel.precision(), sequential.precision());
+}
+
+int formatCallbacks = 0;
+
+void countFormatCallbacks(ios_base::event, ios_base&, int) {
+	++formatCallbacks;
+}
+
+BOOST_AUTO_TEST_CASE(parallel_stream_format) {
+	JSONArray arr;
+	for (int i = 0; i < 100; ++i) {
+		arr.push_back(JSONValue(i + 0.25));
+	}
+	JSONValue val(arr);
+
+	// Formatting of the target stream carries over to the ranges
+	wstringstream sequential;
+	sequential.setf(ios_base::showpos | ios_base::scientific);
+	sequential << val;
+
+	GeneratorOptions options;
+	options.threads = 4;
+	options.parallelThreshold = 1;
+
+	wstringstream parallel;
+	parallel.setf(ios_base::showpos | ios_base::scientific);
+	parallel.register_callback(&countFormatCallbacks, 0);
+	generate(parallel, val, options);
+
+	BOOST_CHECK(parallel.str() == sequential.str());
+
+	// Callbacks on the target stream are not copied to worker buffers
+	BOOST_CHECK_EQUAL(formatCallbacks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_stream_precision) {
+	// Only the first range contains a number. Ranges without numbers must
+	// not undo its precision change, whichever order they finish in.
+	JSONArray arr;
+	arr.push_back(JSONValue(1.5));
+	for (int i = 0; i < 200; ++i) {
+		arr.push_back(JSONValue(L"x"));
+	}
+	JSONValue val(arr);
+
+	wstringstream sequential;
+	sequential << val;
+
+	for (int run = 0; run < 20; ++run) {
+		GeneratorOptions options;
+		options.threads = 4;
+		options.parallelThreshold = 1;
+
+		wstringstream parallel;
+		generate(parallel, val, options);
+
+		BOOST_CHECK(parallel.str() == sequential.str());
+		BOOST_CHECK_EQUAL(parallel.precision(), sequential.precision());
+	}
+}
+
 BOOST_AUTO_TEST_CASE(string_escape_characters)
 {
 
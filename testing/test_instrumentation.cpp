@@ -0,0 +1,158 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <spirit2json_instrumentation.h>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace spirit2json;
+
+BOOST_AUTO_TEST_SUITE(test_instrumentation)
+
+/**
+ * Installs a hook for the lifetime of the scope.
+ */
+struct ScopedInstrumentation {
+	ScopedInstrumentation(Instrumentation& hook) { setInstrumentation(&hook); }
+	~ScopedInstrumentation() { setInstrumentation(0); }
+};
+
+BOOST_AUTO_TEST_CASE(analyze_structure) {
+	DocumentStatistics stats(analyze(parse(L"{\"key\":[1, true, null, \"abc\"], \"other\":{}}")));
+
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_OBJECT], 2u);
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_ARRAY], 1u);
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_NUMBER], 1u);
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_BOOL], 1u);
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_NULL], 1u);
+	BOOST_CHECK_EQUAL(stats.nodes[JSON_STRING], 1u);
+	BOOST_CHECK_EQUAL(stats.maxDepth, 3u);
+	BOOST_CHECK_EQUAL(stats.stringBytes, (3 + 5 + 3) * sizeof(wchar_t));
+	BOOST_CHECK(stats.resultAllocations >= 3u); // Two map nodes and the vector
+	BOOST_CHECK(stats.resultAllocatedBytes > 0);
+
+	BOOST_CHECK_EQUAL(analyze(JSONValue(42.)).maxDepth, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(analyze_unescaped_strings) {
+	DocumentStatistics stats(analyze(parse(L"\"\\u0041\\n\"")));
+	BOOST_CHECK_EQUAL(stats.stringBytes, 2 * sizeof(wchar_t));
+}
+
+BOOST_AUTO_TEST_CASE(disabled_by_default) {
+	BOOST_CHECK(instrumentation() == 0);
+
+	StatisticsCollector collector;
+	parse(L"[1,2,3]");
+
+	BOOST_CHECK_EQUAL(collector.snapshot().parse.calls, 0u);
+	BOOST_CHECK_EQUAL(collector.snapshot().threads, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(collect_parse_and_generate) {
+	StatisticsCollector collector;
+	{
+		ScopedInstrumentation scope(collector);
+
+		JSONValue val(parse(L"[1, \"two\", [3]]"));
+		JSONString json(generate(val));
+
+		wstringstream ss;
+		ss << val;
+
+		BOOST_CHECK_THROW(parse(L"[1, 2"), ParsingFailed);
+
+		StatisticsCollector::Snapshot snapshot(collector.snapshot());
+		BOOST_CHECK_EQUAL(snapshot.threads, 1u);
+
+		BOOST_CHECK_EQUAL(snapshot.parse.calls, 2u);
+		BOOST_CHECK_EQUAL(snapshot.parse.failures, 1u);
+		BOOST_CHECK_EQUAL(snapshot.parse.nodes[JSON_NUMBER], 2u);
+		BOOST_CHECK_EQUAL(snapshot.parse.nodes[JSON_ARRAY], 2u);
+		BOOST_CHECK_EQUAL(snapshot.parse.maxDepth, 3u);
+		BOOST_CHECK_EQUAL(snapshot.parse.maxBytes, wstring(L"[1, \"two\", [3]]").size() * sizeof(wchar_t));
+
+		BOOST_CHECK_EQUAL(snapshot.generate.calls, 2u);
+		BOOST_CHECK_EQUAL(snapshot.generate.bytes, 2 * json.size() * sizeof(wchar_t));
+		BOOST_CHECK_EQUAL(snapshot.generate.nodes[JSON_STRING], 2u);
+		BOOST_CHECK_EQUAL(snapshot.generate.resultAllocations, 1u);
+	}
+
+	parse(L"[]");
+	BOOST_CHECK_EQUAL(collector.snapshot().parse.calls, 2u);
+
+	collector.reset();
+	BOOST_CHECK_EQUAL(collector.snapshot().parse.calls, 0u);
+	BOOST_CHECK_EQUAL(collector.snapshot().generate.calls, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(file_stream_bytes) {
+	const char* path = "test_instrumentation_output.json";
+
+	StatisticsCollector collector;
+	{
+		ScopedInstrumentation scope(collector);
+
+		wofstream file(path);
+		file << JSONValue(parse(L"[\"abc\", 42]"));
+	}
+	const unsigned long long bytes = collector.snapshot().generate.bytes;
+
+	ifstream written(path, ios::binary | ios::ate);
+	const unsigned long long size = static_cast<unsigned long long>(written.tellg());
+	written.close();
+	remove(path);
+
+	// Positions of file streams are already bytes, not characters
+	BOOST_CHECK_EQUAL(bytes, size);
+}
+
+void parseRepeatedly(int count) {
+	for (int i = 0; i < count; ++i) {
+		parse(L"{\"a\":[true, false]}");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_threads) {
+	StatisticsCollector collector;
+	ScopedInstrumentation scope(collector);
+
+	boost::thread_group threads;
+	for (int i = 1; i <= 4; ++i) {
+		threads.create_thread(boost::bind(&parseRepeatedly, i * 10));
+	}
+	threads.join_all();
+
+	StatisticsCollector::Snapshot snapshot(collector.snapshot());
+	BOOST_CHECK_EQUAL(snapshot.threads, 4u);
+	BOOST_CHECK_EQUAL(snapshot.parse.calls, 100u);
+	BOOST_CHECK_EQUAL(snapshot.parse.nodes[JSON_BOOL], 200u);
+	BOOST_CHECK_EQUAL(snapshot.parse.maxDepth, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_export) {
+	StatisticsCollector collector;
+	{
+		ScopedInstrumentation scope(collector);
+		parse(L"[null]");
+	}
+
+	JSONValue exported(collector.snapshot().toJSON());
+	JSONObject& root = boost::get<JSONObject>(exported);
+	JSONObject& parsePhase = boost::get<JSONObject>(root[L"parse"]);
+	JSONObject& nodes = boost::get<JSONObject>(parsePhase[L"nodes"]);
+
+	BOOST_CHECK_EQUAL(boost::get<JSONNumber>(parsePhase[L"calls"]), 1.);
+	BOOST_CHECK_EQUAL(boost::get<JSONNumber>(nodes[L"null"]), 1.);
+	BOOST_CHECK_EQUAL(boost::get<JSONNumber>(root[L"threads"]), 1.);
+
+	// Exported statistics are plain JSON
+	BOOST_CHECK(parse(generate(collector.snapshot().toJSON())) == exported);
+}
+
+BOOST_AUTO_TEST_SUITE_END()